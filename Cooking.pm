@@ -0,0 +1,280 @@
+package Cooking;
+#
+# Parse "What's cooking" editions into a structured form, and keep
+# the result cached on disk keyed by the blob object name of the
+# edition, so that tools that look at the same edition (or at many
+# historical editions) do not have to scan the text again.
+#
+
+use strict;
+use Storable qw(nstore retrieve);
+use Digest::SHA qw(sha1_hex);
+use File::Basename qw(dirname);
+use File::Path qw(mkpath);
+use File::Spec;
+
+# Bump this when the shape of the parsed edition changes.
+my $format = 1;
+
+my $meta = File::Spec->rel2abs(dirname(__FILE__));
+my $cache_dir;
+
+=head1
+Parse the text of an edition
+
+Returns a hash:
+
+    $edition = {
+        'header' => [ $line,... ],	# before the first section
+        'section_list' => [ $section_name,... ],
+        'section_data' => { $section_name => [ $topic_name,... ] },
+        'topic_order' => [ $topic_name,... ],
+        'topic' => {
+            $topic_name => {
+                'name' => $topic_name,
+                'section' => $section_name,
+                'head' => "* topic (date) N commits" line,
+                'date' => tip date, or undef,
+                'count' => number of commits, or undef,
+                'desc' => [ $line,... ],	# commit list, up to a blank line
+                'old' => [ $line,... ],	# inside "<<" ... ">>"
+                'text' => [ $line,... ],	# annotation paragraphs
+            },
+        },
+    }
+
+Lines have their trailing whitespace removed.  The topics in the raw
+"WC generate" output, which has no section header, are placed in a
+section whose name is an empty string.
+
+=cut
+
+sub parse {
+	my ($text) = @_;
+	my (@header, @section, %section, @topic, %topic);
+	my ($section, $topic, $in_old, $in_text);
+
+	for (split(/\n/, $text)) {
+		s/\s+$//;
+		if (defined $topic) {
+			if ($in_old) {
+				if (/^>>$/) {
+					$in_old = 0;
+				} else {
+					push @{$topic->{'old'}}, $_;
+				}
+				next;
+			}
+			if (/^<</ && !/^<<.*>>$/) {
+				$in_old = 1;
+				next;
+			}
+		}
+
+		if (/^\[(.*)\]$/) {
+			$section = $1;
+			$topic = undef;
+			if (!exists $section{$section}) {
+				push @section, $section;
+				$section{$section} = [];
+			}
+			next;
+		}
+
+		if (!defined $section) {
+			if (!/^\* \S+ \(.*\) \d+ commits?$/) {
+				push @header, $_;
+				next;
+			}
+			$section = '';
+			push @section, $section;
+			$section{$section} = [];
+		}
+
+		if (/^-{20,}$/) {
+			$topic = undef;
+			next;
+		}
+
+		if (/^\* (\S+)(?: |$)/) {
+			my $name = $1;
+			push @{$section{$section}}, $name;
+			$in_text = 0;
+			if (exists $topic{$name}) {
+				$topic = $topic{$name};
+				next;
+			}
+			my ($date, $count) = /^\* \S+ \(([-0-9]+)\) (\d+) commits?$/;
+			$topic = $topic{$name} = +{
+				name => $name,
+				section => $section,
+				head => $_,
+				date => $date,
+				count => $count,
+				desc => [],
+				old => [],
+				text => [],
+			};
+			push @topic, $name;
+			next;
+		}
+
+		next if (!defined $topic);
+
+		if ($in_text) {
+			push @{$topic->{'text'}}, $_;
+		} elsif (/^$/) {
+			$in_text = 1;
+		} else {
+			push @{$topic->{'desc'}}, $_;
+		}
+	}
+
+	for my $t (values %topic) {
+		my $ary = $t->{'text'};
+		shift @{$ary} while (@{$ary} && $ary->[0] eq '');
+		pop @{$ary} while (@{$ary} && $ary->[-1] eq '');
+	}
+
+	return +{
+		header => \@header,
+		section_list => \@section,
+		section_data => \%section,
+		topic_order => \@topic,
+		topic => \%topic,
+	};
+}
+
+sub cache_path {
+	my ($oid) = @_;
+
+	if (!defined $cache_dir) {
+		if (exists $ENV{'COOKING_CACHE'}) {
+			$cache_dir = $ENV{'COOKING_CACHE'};
+		} elsif (-d "$meta/.git") {
+			$cache_dir = "$meta/.git/cooking-cache";
+		} else {
+			$cache_dir = `git -C "$meta" rev-parse --git-path cooking-cache 2>/dev/null`;
+			chomp $cache_dir;
+			if ($cache_dir ne '' && !File::Spec->file_name_is_absolute($cache_dir)) {
+				$cache_dir = "$meta/$cache_dir";
+			}
+		}
+	}
+	return if ($cache_dir eq '');
+	return "$cache_dir/$format/" . substr($oid, 0, 2) . "/" . substr($oid, 2);
+}
+
+sub cached {
+	my ($oid, $get_text) = @_;
+	my $path = cache_path($oid);
+	my $edition;
+
+	if (defined $path && -f $path) {
+		$edition = eval { retrieve($path) };
+		return $edition if ($edition);
+	}
+	my $text = $get_text->();
+	return if (!defined $text);
+	$edition = parse($text);
+	if (defined $path) {
+		# Write-and-rename, as readers may race with us.
+		my $tmp = "$path.$$";
+		eval {
+			mkpath(dirname($path));
+			nstore($edition, $tmp);
+			rename($tmp, $path) or die "$!: rename $tmp";
+		};
+		unlink $tmp if ($@);
+	}
+	return $edition;
+}
+
+sub oid_of {
+	my ($text) = @_;
+	return sha1_hex("blob " . length($text) . "\0" . $text);
+}
+
+# Load an edition from its text.
+sub load_text {
+	my ($text) = @_;
+	return cached(oid_of($text), sub { $text });
+}
+
+# Load an edition from an open filehandle.
+sub load_fh {
+	my ($fh) = @_;
+	binmode($fh);
+	my $text = do { local $/; <$fh> };
+	return load_text(defined $text ? $text : '');
+}
+
+# Load an edition from a file; returns undef if it cannot be read.
+# The caller may already know the blob object name of its contents.
+sub load_file {
+	my ($fn, $oid) = @_;
+	my $fh;
+	if (defined $oid && $oid =~ /^[0-9a-f]{40,}$/ && $oid =~ /[1-9a-f]/) {
+		return cached($oid, sub {
+			open($fh, '<', $fn) or return;
+			binmode($fh);
+			my $text = do { local $/; <$fh> };
+			close($fh);
+			return defined $text ? $text : '';
+		});
+	}
+	open($fh, '<', $fn) or return;
+	my $edition = load_fh($fh);
+	close($fh);
+	return $edition;
+}
+
+# Load an edition by its blob object name in the Meta repository.
+sub load_blob {
+	my ($oid) = @_;
+	return cached($oid, sub {
+		my $fh;
+		open($fh, '-|', qw(git -C), $meta, qw(cat-file blob), $oid)
+		    or die "$!: open cat-file $oid";
+		binmode($fh);
+		my $text = do { local $/; <$fh> };
+		close($fh) or return;
+		return $text;
+	});
+}
+
+# Blob object names of the last $count editions of $path recorded in
+# the history of $rev in the Meta repository, newest first, found
+# with a single traversal.
+sub history {
+	my ($count, $rev, $path) = @_;
+	my ($fh, @oid);
+	open($fh, '-|', qw(git -C), $meta,
+	     qw(log --no-abbrev --format= --raw), "-$count", $rev, '--', $path)
+	    or die "$!: open log --raw";
+	while (<$fh>) {
+		my ($oid) = /^:\S+ \S+ \S+ ([0-9a-f]+) [^D]/;
+		next if (!defined $oid || $oid !~ /[1-9a-f]/);
+		push @oid, $oid;
+	}
+	close($fh);
+	return @oid;
+}
+
+# Does the annotation line tell what is planned for the topic?
+sub wildo_match {
+	local ($_) = @_;
+	s/^\s+//;
+	if (/^Will (?:\S+ ){0,2}(fast-track|hold|keep|merge|drop|discard|cook|kick|defer|eject|be re-?rolled|wait)[,. ]/ ||
+	    /^Not urgent/ || /^Not ready/ || /^Waiting for / ||
+	    /^Can wait in / || /^Still / || /^Stuck / || /^On hold/ ||
+	    /^Needs? / || /^Expecting / || /^May want to /) {
+		return 1;
+	}
+	if (/^I think this is ready for /) {
+		return 1;
+	}
+	return 0;
+}
+
+1;
@@ -0,0 +1,302 @@
+package TopicState;
+#
+# A materialized view of the topic branches: the commits on each
+# ??/* topic that are not in 'master', which integration branches
+# have them, and when each topic tip was merged to 'next'.
+#
+# The state is kept in $GIT_COMMON_DIR/topic-state and is brought up
+# to date incrementally by refresh(), which only looks at the refs
+# that moved since the last time.  The reference-transaction hook
+# calls "Meta/topic-state refresh" whenever a branch is updated, so
+# readers usually find it current and do not have to walk history.
+#
+
+use strict;
+use Storable qw(nstore retrieve);
+use Fcntl qw(O_CREAT O_EXCL O_WRONLY);
+
+# Bump this when the shape of the state changes.
+my $format = 1;
+
+our $base = 'master';
+our @integration = qw(next pu jch);
+my $topic_pattern = 'refs/heads/??/*';
+
+=head1
+The state
+
+    $state = {
+        'format' => $format,
+        'tip' => { $branch => $commit },	# master and integration branches
+        'topic' => {
+            $topic => {
+                'tip' => $commit,
+                'date' => committer date of the tip (iso8601),
+                'commits' => [ $commit,... ],	# master..$topic, newest first
+                'up_to_date' => true if the topic contains master,
+            },
+        },
+        'commit' => { $commit => [ $subject, $author, $is_merge ] },
+        'in' => { $branch => { $commit => 1 } },	# master..$branch
+        'merged' => { $commit => [ $date, $abbrev ] },	# merged to 'next' by $abbrev
+    }
+
+=cut
+
+sub state_file {
+	my $dir = `git rev-parse --git-common-dir`;
+	chomp $dir;
+	die "not in a git repository" if ($dir eq '');
+	return "$dir/topic-state";
+}
+
+sub is_ancestor {
+	my ($a, $b) = @_;
+	return system(qw(git merge-base --is-ancestor), $a, $b) == 0;
+}
+
+sub read_refs {
+	my ($fh, %tip, %topic);
+	open($fh, '-|', qw(git for-each-ref),
+	     '--format=%(objectname) %(committerdate:iso8601) %(refname)',
+	     (map { "refs/heads/$_" } ($base, @integration)), $topic_pattern)
+	    or die "$!: open for-each-ref";
+	while (<$fh>) {
+		chomp;
+		my ($commit, $date, $ref) = /^([0-9a-f]+) (.*) (refs\/heads\/.*)$/;
+		my $name = substr($ref, 11);
+		if (grep { $_ eq $name } ($base, @integration)) {
+			$tip{$name} = $commit;
+		} else {
+			$topic{$name} = [$commit, $date];
+		}
+	}
+	close($fh) or die "$!: close for-each-ref";
+	return (\%tip, \%topic);
+}
+
+sub rev_list {
+	my (@arg) = @_;
+	my ($fh, @commit);
+	open($fh, '-|', qw(git rev-list), @arg)
+	    or die "$!: open rev-list";
+	while (<$fh>) {
+		chomp;
+		push @commit, $_;
+	}
+	close($fh) or die "$!: close rev-list @arg";
+	return @commit;
+}
+
+sub read_topic {
+	my ($state, $name, $tip, $date) = @_;
+	my ($fh, @commit);
+	open($fh, '-|', qw(git log), '--format=%H%x09%P%x09%an <%ae>%x09%s',
+	     $tip, "^$state->{'tip'}{$base}")
+	    or die "$!: open log $name";
+	while (<$fh>) {
+		chomp;
+		my ($commit, $parent, $author, $subject) = split(/\t/, $_, 4);
+		$state->{'commit'}{$commit} ||=
+		    [$subject, $author, ($parent =~ tr/ //) ? 1 : 0];
+		push @commit, $commit;
+	}
+	close($fh) or die "$!: close log $name";
+	$state->{'topic'}{$name} = +{
+		tip => $tip,
+		date => $date,
+		commits => \@commit,
+		up_to_date => 0,
+	};
+}
+
+sub read_integration {
+	my ($state, $branch, $old) = @_;
+	my $tip = $state->{'tip'}{$branch};
+	if (!defined $tip) {
+		delete $state->{'in'}{$branch};
+		return;
+	}
+	if (defined $old && exists $state->{'in'}{$branch} &&
+	    is_ancestor($old, $tip)) {
+		$state->{'in'}{$branch}{$_} = 1
+		    for (rev_list($tip, "^$old", "^$state->{'tip'}{$base}"));
+	} else {
+		$state->{'in'}{$branch} =
+		    +{ map { $_ => 1 } rev_list($tip, "^$state->{'tip'}{$base}") };
+	}
+}
+
+sub read_merged {
+	my ($state) = @_;
+	my $fh;
+	$state->{'merged'} = {};
+	return if (!defined $state->{'tip'}{'next'});
+	open($fh, '-|', qw(git log --first-parent --abbrev --date=short),
+	     "--format=%cd %h %P", "$base..next")
+	    or die "$!: open log $base..next";
+	while (<$fh>) {
+		my ($date, $commit, @parent) = split(' ', $_);
+		for my $tip (@parent) {
+			$state->{'merged'}{$tip} = [$date, $commit];
+		}
+	}
+	close($fh) or die "$!: close log $base..next";
+}
+
+sub read_up_to_date {
+	my ($state) = @_;
+	my $fh;
+	open($fh, '-|', qw(git for-each-ref --format=%(refname)),
+	     "--contains=$state->{'tip'}{$base}", $topic_pattern)
+	    or die "$!: open for-each-ref --contains";
+	while (<$fh>) {
+		chomp;
+		my $name = substr($_, 11);
+		$state->{'topic'}{$name}{'up_to_date'} = 1
+		    if (exists $state->{'topic'}{$name});
+	}
+	close($fh) or die "$!: close for-each-ref --contains";
+}
+
+# Bring $state (or a new one, if undef) up to date with the refs.
+sub update {
+	my ($state) = @_;
+	my ($tip, $topic) = read_refs();
+	my $master = $tip->{$base};
+	die "no $base branch" if (!defined $master);
+
+	if (!$state || !defined $state->{'format'} ||
+	    $state->{'format'} != $format ||
+	    ($state->{'tip'}{$base} ne $master &&
+	     !is_ancestor($state->{'tip'}{$base}, $master))) {
+		$state = +{
+			format => $format,
+			tip => {},
+			topic => {},
+			commit => {},
+			in => {},
+			merged => {},
+		};
+	}
+	my %old_tip = %{$state->{'tip'}};
+	my $master_moved = (!defined $old_tip{$base} || $old_tip{$base} ne $master);
+	$state->{'tip'} = $tip;
+
+	if ($master_moved && defined $old_tip{$base}) {
+		# Forget what graduated to master.
+		my %gone = map { $_ => 1 } rev_list($master, "^$old_tip{$base}");
+		for my $in (values %{$state->{'in'}}) {
+			delete @{$in}{keys %gone};
+		}
+		for my $t (values %{$state->{'topic'}}) {
+			@{$t->{'commits'}} = grep { !$gone{$_} } @{$t->{'commits'}};
+		}
+		delete @{$state->{'commit'}}{keys %gone};
+	}
+
+	for my $branch (@integration) {
+		my $old = $old_tip{$branch};
+		next if (!$master_moved && defined $old && defined $tip->{$branch} &&
+			 $old eq $tip->{$branch});
+		read_integration($state, $branch, $old);
+	}
+	if ($master_moved || ($old_tip{'next'} || '') ne ($tip->{'next'} || '')) {
+		read_merged($state);
+	}
+
+	my $topic_moved = 0;
+	for my $name (keys %{$state->{'topic'}}) {
+		next if (exists $topic->{$name});
+		delete $state->{'topic'}{$name};
+	}
+	for my $name (keys %{$topic}) {
+		my ($commit, $date) = @{$topic->{$name}};
+		next if (exists $state->{'topic'}{$name} &&
+			 $state->{'topic'}{$name}{'tip'} eq $commit);
+		read_topic($state, $name, $commit, $date);
+		$topic_moved = 1;
+	}
+	if ($master_moved || $topic_moved) {
+		$_->{'up_to_date'} = 0 for (values %{$state->{'topic'}});
+		read_up_to_date($state);
+	}
+	if ($topic_moved) {
+		# Forget commits on rewound topics.
+		my %used = map { map { $_ => 1 } @{$_->{'commits'}} }
+			values %{$state->{'topic'}};
+		delete @{$state->{'commit'}}{grep { !$used{$_} }
+					       keys %{$state->{'commit'}}};
+	}
+	return $state;
+}
+
+# Refresh the state on disk; returns the up-to-date state.  When
+# somebody else is updating it, do the work in core without saving.
+sub refresh {
+	my $file = state_file();
+	my $state = -f $file ? eval { retrieve($file) } : undef;
+	my $lock;
+	my $locked = sysopen($lock, "$file.lock", O_CREAT | O_EXCL | O_WRONLY);
+	if (!$locked && -M "$file.lock" > 10 / (24 * 60)) {
+		# Left behind by a refresh that was killed.
+		unlink("$file.lock");
+		$locked = sysopen($lock, "$file.lock", O_CREAT | O_EXCL | O_WRONLY);
+	}
+	$state = update($state);
+	if ($locked) {
+		nstore($state, "$file.lock.new");
+		rename("$file.lock.new", $file) or die "$!: rename $file";
+		close($lock);
+		unlink("$file.lock");
+	}
+	return $state;
+}
+
+# Does $state record exactly these branch tips?
+sub is_current {
+	my ($state, $tip, $topic) = @_;
+	return 0 if (!$state || !defined $state->{'format'} ||
+		     $state->{'format'} != $format);
+	my $old_tip = $state->{'tip'};
+	my $old_topic = $state->{'topic'};
+	return 0 if (keys %$old_tip != keys %$tip ||
+		     keys %$old_topic != keys %$topic);
+	for (keys %$tip) {
+		return 0 if (($old_tip->{$_} || '') ne $tip->{$_});
+	}
+	for (keys %$topic) {
+		return 0 if (!exists $old_topic->{$_} ||
+			     $old_topic->{$_}{'tip'} ne $topic->{$_}[0]);
+	}
+	return 1;
+}
+
+# Load the state, refreshing it if the hook did not.  When no branch
+# moved since it was stored, the file is only read, not rewritten.
+sub load {
+	my $file = state_file();
+	my $state = -f $file ? eval { retrieve($file) } : undef;
+	my ($tip, $topic) = read_refs();
+	return $state if (is_current($state, $tip, $topic));
+	return refresh();
+}
+
+# Does integration branch $branch have $commit?
+sub in {
+	my ($state, $branch, $commit) = @_;
+	return exists $state->{'in'}{$branch} && $state->{'in'}{$branch}{$commit};
+}
+
+# Commits on $topic that are not in master, newest first.
+sub commits {
+	my ($state, $topic) = @_;
+	return if (!exists $state->{'topic'}{$topic});
+	return @{$state->{'topic'}{$topic}{'commits'}};
+}
+
+sub subject { $_[0]->{'commit'}{$_[1]}[0]; }
+sub author { $_[0]->{'commit'}{$_[1]}[1]; }
+sub is_merge { $_[0]->{'commit'}{$_[1]}[2]; }
+
+1;
@@ -45,7 +45,7 @@ perl -w -e '
 ' "$@" |
 while read new
 do
-	commitcnt=$(git rev-list --no-merges "$new" | wc -l)
+	commitcnt=$(git rev-list --count --no-merges "$new")
 	git shortlog -s -n "$new" |
 	sed -e 's/^[ 	0-9]*//' |
 	sort >/var/tmp/new
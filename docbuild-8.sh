@@ -1,18 +1,142 @@
 #!/bin/sh
+#
+# Meta/docbuild-8.sh [7 | 8]
+# Meta/docbuild-8.sh --compare [7] [8] [doctor]
+#
+# Build and install the documentation with asciidoc 7 or 8 into
+# /var/tmp/asciidoc$V.
+#
+# With --compare, build with each of the given toolchains (7 and 8 if
+# none is given; "doctor" is Asciidoctor) at the same time, each from
+# its own copy of the files in this checkout, and then list the pages
+# whose output differs from that of the first one.  The trees are
+# compared by the object names of their files, once the lines that
+# only name the toolchain are taken out, so only the pages that differ
+# are looked at any further.
+
+variant () {
+	case "$1" in
+	7)
+		V=7
+		EXTRA=
+		;;
+	8 | '')
+		V=8
+		EXTRA=ASCIIDOC8=YesPlease
+		;;
+	doctor)
+		V=tor
+		EXTRA=USE_ASCIIDOCTOR=YesPlease
+		;;
+	*)
+		echo >&2 "Unknown toolchain: $1"
+		return 1
+		;;
+	esac
+	DEST=/var/tmp/asciidoc$V
+}
+
+build () {
+	case "$V" in
+	8)
+		PATH=~/asciidoc/bin:$PATH make prefix=$DEST \
+			WEBDOC_DEST=$DEST/webdoc \
+			$EXTRA \
+			install install-webdoc ;;
+	*)
+		make prefix=$DEST \
+			WEBDOC_DEST=$DEST/webdoc \
+			$EXTRA \
+			install install-webdoc ;;
+	esac
+}
 
 case "$1" in
-7)
-	V=7
-	EXTRA=
+--compare)
+	shift
 	;;
-8 | '')
-	V=8
-	PATH=~/asciidoc/bin:$PATH
-	EXTRA=ASCIIDOC8=YesPlease
+*)
+	variant "$1" || exit
+	build
+	exit
 	;;
 esac
 
-make prefix=/var/tmp/asciidoc$V \
-	WEBDOC_DEST=/var/tmp/asciidoc$V/webdoc \
-	$EXTRA \
-	install install-webdoc
+test $# = 0 && set 7 8
+top=$(git rev-parse --show-toplevel) &&
+tmp=/var/tmp/docbuild-$$ &&
+mkdir -p "$tmp" || exit
+trap 'rm -fr "$tmp"' 0 1 2 3 15
+
+# Start all the builds; each gets its own copy of the tree (with the
+# local changes), as they would step on each other's intermediate
+# files in a single one.
+for t
+do
+	variant "$t" || exit
+	(
+		mkdir "$tmp/$V" &&
+		cd "$top" &&
+		git ls-files -z | tar --null -T - -cf - |
+		tar Cxf "$tmp/$V" - &&
+		if v=$(git describe HEAD 2>/dev/null)
+		then
+			echo "$v" | sed -e 's/-/./g' -e 's/^v//' >"$tmp/$V/version"
+		fi &&
+		rm -fr "$DEST" &&
+		cd "$tmp/$V/Documentation" &&
+		build >"$tmp/$V.log" 2>&1
+		echo $? >"$tmp/$V.status"
+	) &
+done
+wait
+
+failed=
+for t
+do
+	variant "$t"
+	if test "$(cat "$tmp/$V.status" 2>/dev/null)" != 0
+	then
+		echo >&2 "** build with $t failed"
+		test -f "$tmp/$V.log" && tail -n 20 "$tmp/$V.log" >&2
+		failed=y
+		continue
+	fi
+	# "<object name> <path>", sorted by path, of the pages without
+	# what names the toolchain (the generator and the footer), which
+	# would make every page differ.
+	(
+		cd "$DEST" &&
+		find . -type f | sed -e 's|^\./||' | sort >"$tmp/$V.files" &&
+		while read f
+		do
+			mkdir -p "$tmp/$V.norm/${f%/*}" &&
+			LC_ALL=C sed -e '/<meta name="generator"/d' \
+				-e '/^\.\\" *Generator:/d' \
+				-e '/<div id="footer-text">/,/<\/div>/d' \
+				"$f" >"$tmp/$V.norm/$f" || exit
+		done <"$tmp/$V.files" &&
+		cd "$tmp/$V.norm" &&
+		git hash-object --stdin-paths <"$tmp/$V.files" |
+		paste -d ' ' - "$tmp/$V.files" >"$tmp/$V.hashes"
+	) || failed=y
+done
+test -z "$failed" || exit 1
+
+variant "$1"
+base=$V
+shift
+for t
+do
+	variant "$t"
+	echo "* asciidoc$base vs asciidoc$V"
+	join -1 2 -2 2 -a 1 -a 2 -e - -o 0,1.1,2.1 \
+		"$tmp/$base.hashes" "$tmp/$V.hashes" |
+	awk -v a="asciidoc$base" -v b="asciidoc$V" '
+	$2 == $3 { same++; next }
+	$2 == "-" { print "only in " b ":\t" $1; next }
+	$3 == "-" { print "only in " a ":\t" $1; next }
+	{ print "differs:\t" $1 }
+	END { printf "(%d pages the same)\n", same }
+	'
+done